@@ -9,6 +9,10 @@
 #include <algorithm>
 #include <cmath>
 #include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <stdint.h>
 
 using namespace std;
 
@@ -176,58 +180,322 @@ private:
     }
 };
 
+class PnLRollup {
+public:
+    enum OutputFormat {
+        CSV,
+        BINARY
+    };
+    
+    // widths are in timestamp units; every result is added to one bucket per width
+    PnLRollup(const vector<long>& widths, ostream& out, OutputFormat format)
+        : widths_(widths), windows_(widths.size()), out_(out), format_(format),
+          lastSymbol_(0), skipped_(0) {}
+    
+    void writeHeader() {
+        if (format_ == CSV) {
+            out_ << "BUCKET_START,WIDTH,SYMBOL,PNL,COUNT" << endl;
+        }
+    }
+    
+    void add(const PnLResult& result) {
+        size_t symbol = symbolIndex(result.symbol);
+        
+        for (size_t i = 0; i < widths_.size(); ++i) {
+            Window& window = windows_[i];
+            long start = bucketStart(result.timestamp, widths_[i]);
+            
+            if (!window.open) {
+                window.start = start;
+                window.open = true;
+            } else if (start > window.start) {
+                // time moved past this bucket, so every symbol in it is final
+                emit(window, widths_[i]);
+                window.start = start;
+            } else if (start < window.start) {
+                // late result: its bucket was already written, so write it on its own
+                writeBucket(start, widths_[i], result.symbol, result.pnl, 1);
+                continue;
+            }
+            
+            if (window.accumulators.size() <= symbol) {
+                window.accumulators.resize(symbols_.size());
+            }
+            Accumulator& acc = window.accumulators[symbol];
+            if (acc.count == 0) {
+                window.touched.push_back(symbol);
+            }
+            acc.pnl += result.pnl;
+            acc.count += 1;
+        }
+    }
+    
+    void add(const vector<PnLResult>& results) {
+        for (vector<PnLResult>::const_iterator it = results.begin(); it != results.end(); ++it) {
+            add(*it);
+        }
+    }
+    
+    // emits the buckets that are still open; call once the input is exhausted
+    void flush() {
+        for (size_t i = 0; i < widths_.size(); ++i) {
+            if (windows_[i].open) {
+                emit(windows_[i], widths_[i]);
+                windows_[i].open = false;
+            }
+        }
+        out_.flush();
+    }
+    
+    // buckets dropped from binary output because the symbol did not fit the length field
+    size_t getSkipped() const { return skipped_; }
+    
+    static long bucketStart(long timestamp, long width) {
+        long start = (timestamp / width) * width;
+        if (start > timestamp) {
+            start -= width; // round towards negative infinity
+        }
+        return start;
+    }
+    
+private:
+    struct Accumulator {
+        Accumulator() : pnl(0.0), count(0) {}
+        double pnl;
+        long count;
+    };
+    
+    // accumulators are indexed by symbol and kept across buckets; touched lists
+    // the ones in use by the open bucket
+    struct Window {
+        Window() : start(0), open(false) {}
+        long start;
+        bool open;
+        vector<Accumulator> accumulators;
+        vector<size_t> touched;
+    };
+    
+    struct SymbolLess {
+        SymbolLess(const vector<string>& symbols) : symbols_(symbols) {}
+        bool operator()(size_t a, size_t b) const { return symbols_[a] < symbols_[b]; }
+        const vector<string>& symbols_;
+    };
+    
+    vector<long> widths_;
+    vector<Window> windows_;
+    ostream& out_;
+    OutputFormat format_;
+    map<string, size_t> symbolIds_;
+    vector<string> symbols_;
+    size_t lastSymbol_;
+    size_t skipped_;
+    
+    // results tend to repeat a symbol, so the last one is checked before the map
+    size_t symbolIndex(const string& symbol) {
+        if (lastSymbol_ < symbols_.size() && symbols_[lastSymbol_] == symbol) {
+            return lastSymbol_;
+        }
+        
+        map<string, size_t>::iterator it = symbolIds_.find(symbol);
+        if (it == symbolIds_.end()) {
+            it = symbolIds_.insert(make_pair(symbol, symbols_.size())).first;
+            symbols_.push_back(symbol);
+        }
+        lastSymbol_ = it->second;
+        return lastSymbol_;
+    }
+    
+    void emit(Window& window, long width) {
+        sort(window.touched.begin(), window.touched.end(), SymbolLess(symbols_));
+        
+        for (vector<size_t>::const_iterator it = window.touched.begin(); it != window.touched.end(); ++it) {
+            Accumulator& acc = window.accumulators[*it];
+            writeBucket(window.start, width, symbols_[*it], acc.pnl, acc.count);
+            acc = Accumulator();
+        }
+        window.touched.clear();
+    }
+    
+    void writeBucket(long start, long width, const string& symbol, double pnl, long count) {
+        if (format_ == CSV) {
+            double displayPnl = (fabs(pnl) < 1e-9) ? 0.0 : pnl;
+            out_ << start << "," << width << "," << symbol << ","
+                 << fixed << setprecision(2) << displayPnl << "," << count << "\n";
+        } else {
+            writeRecord(start, width, symbol, pnl, count);
+        }
+    }
+    
+    // record layout (native byte order): int64 start, int64 width, int64 count,
+    // float64 pnl, uint16 symbol length, symbol bytes
+    void writeRecord(long start, long width, const string& symbol, double pnl, long count) {
+        if (symbol.size() > 0xFFFF) {
+            ++skipped_;
+            return;
+        }
+        int64_t fields[3] = { start, width, count };
+        uint16_t length = static_cast<uint16_t>(symbol.size());
+        out_.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+        out_.write(reinterpret_cast<const char*>(&pnl), sizeof(pnl));
+        out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out_.write(symbol.data(), length);
+    }
+};
+
+enum ParseErrorCode {
+    BAD_FIELD_COUNT,
+    BAD_TIMESTAMP,
+    NON_MONOTONIC_TIMESTAMP,
+    EMPTY_SYMBOL,
+    BAD_SIDE,
+    BAD_PRICE,
+    BAD_QUANTITY
+};
+
+struct ParseError {
+    long line;
+    long offset;
+    ParseErrorCode code;
+};
+
+// Keeps the first `capacity` errors; later ones are only counted
+class ParseReport {
+public:
+    ParseReport(size_t capacity = 100)
+        : capacity_(capacity), total_(0), stopped_(false), failed_(false) {
+        errors_.reserve(capacity);
+    }
+    
+    void record(long line, long offset, ParseErrorCode code) {
+        ++total_;
+        if (errors_.size() < capacity_) {
+            ParseError error;
+            error.line = line;
+            error.offset = offset;
+            error.code = code;
+            errors_.push_back(error);
+        }
+    }
+    
+    const vector<ParseError>& getErrors() const { return errors_; }
+    size_t getTotal() const { return total_; }
+    bool isTruncated() const { return total_ > errors_.size(); }
+    bool isStopped() const { return stopped_; }
+    void setStopped(bool stopped) { stopped_ = stopped; }
+    // set when the input or quarantine file could not be opened
+    bool isFailed() const { return failed_; }
+    void setFailed(bool failed) { failed_ = failed; }
+    
+    static const char* describe(ParseErrorCode code) {
+        switch (code) {
+            case BAD_FIELD_COUNT: return "expected 5 fields";
+            case BAD_TIMESTAMP: return "timestamp is not an integer";
+            case NON_MONOTONIC_TIMESTAMP: return "timestamp goes backwards";
+            case EMPTY_SYMBOL: return "symbol is empty";
+            case BAD_SIDE: return "side must be B or S";
+            case BAD_PRICE: return "price is not a number";
+            case BAD_QUANTITY: return "quantity must be a positive integer";
+        }
+        return "unknown error";
+    }
+    
+    void print(ostream& out) const {
+        for (vector<ParseError>::const_iterator it = errors_.begin(); it != errors_.end(); ++it) {
+            out << "line " << it->line << ", byte " << it->offset << ": " << describe(it->code) << endl;
+        }
+        if (isTruncated()) {
+            out << (total_ - errors_.size()) << " more errors not shown" << endl;
+        }
+    }
+    
+private:
+    size_t capacity_;
+    size_t total_;
+    bool stopped_;
+    bool failed_;
+    vector<ParseError> errors_;
+};
+
 class CSVParser {
 public:
+    enum ErrorPolicy {
+        SKIP,
+        STOP
+    };
+    
+    struct Options {
+        Options() : policy(SKIP) {}
+        ErrorPolicy policy;
+        string quarantineFile; // if set, bad rows are also copied here verbatim
+    };
+    
     static vector<Trade> parseFile(const string& filename) {
+        ParseReport report;
+        return parseFile(filename, Options(), report);
+    }
+    
+    static vector<Trade> parseFile(const string& filename, const Options& options, ParseReport& report) {
         vector<Trade> trades;
-        ifstream file(filename);
+        ifstream file(filename.c_str());
         
         if (!file.is_open()) {
+            report.setFailed(true);
             cerr << "Error: Could not open file " << filename << endl;
             return trades;
         }
         
-        string line;
-        getline(file, line); 
-        
-        // handling malformed header
-        for (size_t i = 0; i < line.length(); ++i) {
-            if (line[i] == ' ') {
-                line[i] = '\n';
+        ofstream quarantine;
+        if (!options.quarantineFile.empty()) {
+            quarantine.open(options.quarantineFile.c_str());
+            if (!quarantine.is_open()) {
+                report.setFailed(true);
+                cerr << "Error: Could not open quarantine file " << options.quarantineFile << endl;
+                return trades;
             }
         }
         
-        stringstream ss(line);
-        string headerLine;
-        getline(ss, headerLine); 
+        State state(options, report, quarantine);
         
-        string tradeLine;
-        while (getline(ss, tradeLine)) {
-            if (tradeLine.empty()) continue;
-            
-            vector<string> tokens = split(tradeLine, ',');
-            if (tokens.size() >= 5) {
-                long timestamp = strtol(tokens[0].c_str(), NULL, 10);
-                string symbol = tokens[1];
-                char side = tokens[2][0];
-                double price = strtod(tokens[3].c_str(), NULL);
-                long quantity = strtol(tokens[4].c_str(), NULL, 10);
-                trades.push_back(Trade(timestamp, symbol, side, price, quantity));
+        string line;
+        getline(file, line);
+        long lineNumber = 1;
+        long lineOffset = 0;
+        size_t lineLength = line.length();
+        if (lineLength > 0 && line[lineLength - 1] == '\r') {
+            line.erase(lineLength - 1);
+        }
+        
+        // handling malformed header: rows glued to the header are separated by spaces
+        size_t rowStart = line.find(' ');
+        while (rowStart != string::npos) {
+            ++rowStart;
+            size_t rowEnd = line.find(' ', rowStart);
+            size_t end = (rowEnd == string::npos) ? line.length() : rowEnd;
+            if (end > rowStart &&
+                !parseRow(line.data() + rowStart, line.data() + end, lineNumber,
+                          lineOffset + static_cast<long>(rowStart), state, trades)) {
+                return trades;
             }
+            rowStart = rowEnd;
         }
         
-        while (getline(file, line)) {
-            if (line.empty()) continue;
+        while (file.good()) {
+            lineOffset += static_cast<long>(lineLength) + 1;
+            if (!getline(file, line)) {
+                break;
+            }
+            ++lineNumber;
+            lineLength = line.length();
             
-            vector<string> tokens = split(line, ',');
-            if (tokens.size() >= 5) {
-                long timestamp = stol(tokens[0]);
-                string symbol = tokens[1];
-                char side = tokens[2][0];
-                double price = stod(tokens[3]);
-                long quantity = stol(tokens[4]);
-                
-                trades.emplace_back(timestamp, symbol, side, price, quantity);
+            const char* begin = line.data();
+            const char* end = begin + line.length();
+            if (end > begin && end[-1] == '\r') {
+                --end;
+            }
+            if (end == begin) continue;
+            
+            if (!parseRow(begin, end, lineNumber, lineOffset, state, trades)) {
+                return trades;
             }
         }
         
@@ -235,22 +503,173 @@ public:
     }
     
 private:
-    static vector<string> split(const string& str, char delimiter) {
-        vector<string> tokens;
-        stringstream ss(str);
-        string token;
+    struct State {
+        State(const Options& options, ParseReport& report, ofstream& quarantine)
+            : options(options), report(report), quarantine(quarantine),
+              lastTimestamp(0), hasTimestamp(false) {}
+        const Options& options;
+        ParseReport& report;
+        ofstream& quarantine;
+        long lastTimestamp;
+        bool hasTimestamp;
+    };
+    
+    // returns false once parsing must stop
+    static bool parseRow(const char* begin, const char* end, long lineNumber, long offset,
+                         State& state, vector<Trade>& trades) {
+        const char* fields[6];
+        const char* fieldEnds[6];
+        int count = 0;
+        
+        const char* fieldStart = begin;
+        for (const char* p = begin; ; ++p) {
+            if (p == end || *p == ',') {
+                if (count == 6) {
+                    count = 7; // more than six fields, never a trailing comma
+                    break;
+                }
+                fields[count] = fieldStart;
+                fieldEnds[count] = p;
+                ++count;
+                if (p == end) {
+                    break;
+                }
+                fieldStart = p + 1;
+            }
+        }
         
-        while (getline(ss, token, delimiter)) {
-            tokens.push_back(token);
+        // a trailing comma leaves an empty sixth field, which the old parser accepted
+        if (count == 6 && fields[5] == fieldEnds[5]) {
+            count = 5;
+        }
+        if (count != 5) {
+            return reject(begin, end, lineNumber, offset, BAD_FIELD_COUNT, state);
         }
         
-        return tokens;
+        long timestamp;
+        if (!parseLong(fields[0], fieldEnds[0], timestamp)) {
+            return reject(begin, end, lineNumber, offset, BAD_TIMESTAMP, state);
+        }
+        if (state.hasTimestamp && timestamp < state.lastTimestamp) {
+            return reject(begin, end, lineNumber, offset, NON_MONOTONIC_TIMESTAMP, state);
+        }
+        
+        if (fields[1] == fieldEnds[1]) {
+            return reject(begin, end, lineNumber, offset, EMPTY_SYMBOL, state);
+        }
+        
+        if (fieldEnds[2] - fields[2] != 1 || (fields[2][0] != 'B' && fields[2][0] != 'S')) {
+            return reject(begin, end, lineNumber, offset, BAD_SIDE, state);
+        }
+        char side = fields[2][0];
+        
+        double price;
+        if (!parseDouble(fields[3], fieldEnds[3], price)) {
+            return reject(begin, end, lineNumber, offset, BAD_PRICE, state);
+        }
+        
+        long quantity;
+        if (!parseLong(fields[4], fieldEnds[4], quantity) || quantity <= 0) {
+            return reject(begin, end, lineNumber, offset, BAD_QUANTITY, state);
+        }
+        
+        state.lastTimestamp = timestamp;
+        state.hasTimestamp = true;
+        trades.push_back(Trade(timestamp, string(fields[1], fieldEnds[1]), side, price, quantity));
+        return true;
+    }
+    
+    static bool reject(const char* begin, const char* end, long lineNumber, long offset,
+                       ParseErrorCode code, State& state) {
+        state.report.record(lineNumber, offset, code);
+        
+        if (state.quarantine.is_open()) {
+            state.quarantine.write(begin, end - begin);
+            state.quarantine.put('\n');
+        }
+        if (state.options.policy == STOP) {
+            state.report.setStopped(true);
+            return false;
+        }
+        
+        return true;
+    }
+    
+    // the field must be non-empty and fully consumed; fields end at ',', ' ' or the
+    // end of the line, all of which stop strtol/strtod
+    static bool parseLong(const char* begin, const char* end, long& value) {
+        if (!startsNumber(begin, end)) {
+            return false;
+        }
+        char* parsed;
+        errno = 0;
+        value = strtol(begin, &parsed, 10);
+        return parsed == end && errno == 0;
+    }
+    
+    static bool parseDouble(const char* begin, const char* end, double& value) {
+        if (!startsNumber(begin, end)) {
+            return false;
+        }
+        char* parsed;
+        errno = 0;
+        const char* digits = (*begin == '-') ? begin + 1 : begin;
+        if (end - digits >= 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+            return false; // strtod would read it as a hexadecimal float
+        }
+        value = strtod(begin, &parsed);
+        return parsed == end && errno == 0 && value == value && fabs(value) <= 1e300;
+    }
+    
+    // strtol/strtod would skip leading whitespace and accept a '+' sign
+    static bool startsNumber(const char* begin, const char* end) {
+        return begin != end &&
+               (isdigit(static_cast<unsigned char>(*begin)) || *begin == '-' || *begin == '.');
     }
 };
 
+// parses a comma separated list of distinct bucket widths, e.g. "1s,1m,1h" or "60,3600";
+// the s/m/h suffixes assume timestamps are in seconds
+static bool parseWidths(const string& spec, vector<long>& widths) {
+    stringstream ss(spec);
+    string token;
+    
+    while (getline(ss, token, ',')) {
+        char* end = NULL;
+        errno = 0;
+        long width = strtol(token.c_str(), &end, 10);
+        if (end == token.c_str() || errno == ERANGE || width <= 0) {
+            return false;
+        }
+        
+        string unit(end);
+        long multiplier = 1;
+        if (unit == "m") {
+            multiplier = 60;
+        } else if (unit == "h") {
+            multiplier = 3600;
+        } else if (!unit.empty() && unit != "s") {
+            return false;
+        }
+        
+        if (width > LONG_MAX / multiplier) {
+            return false;
+        }
+        width *= multiplier;
+        
+        if (find(widths.begin(), widths.end(), width) != widths.end()) {
+            return false;
+        }
+        widths.push_back(width);
+    }
+    
+    return !widths.empty();
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " <csv_file> <fifo|lifo>" << endl;
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <csv_file> <fifo|lifo> [--rollup <widths>] [--binary]"
+             << " [--on-error <skip|stop>] [--quarantine <file>]" << endl;
         return 1;
     }
     
@@ -267,7 +686,58 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    vector<Trade> trades = CSVParser::parseFile(filename);
+    CSVParser::Options parseOptions;
+    vector<long> rollupWidths;
+    PnLRollup::OutputFormat rollupFormat = PnLRollup::CSV;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--rollup" && i + 1 < argc) {
+            if (!rollupWidths.empty()) {
+                cerr << "Error: --rollup given more than once" << endl;
+                return 1;
+            }
+            if (!parseWidths(argv[++i], rollupWidths)) {
+                cerr << "Error: Invalid rollup widths '" << argv[i] << "'" << endl;
+                return 1;
+            }
+        } else if (option == "--on-error" && i + 1 < argc) {
+            string policy = argv[++i];
+            if (policy == "skip") {
+                parseOptions.policy = CSVParser::SKIP;
+            } else if (policy == "stop") {
+                parseOptions.policy = CSVParser::STOP;
+            } else {
+                cerr << "Error: --on-error must be 'skip' or 'stop'" << endl;
+                return 1;
+            }
+        } else if (option == "--quarantine" && i + 1 < argc) {
+            parseOptions.quarantineFile = argv[++i];
+        } else if (option == "--binary") {
+            rollupFormat = PnLRollup::BINARY;
+        } else {
+            cerr << "Error: Unknown option '" << option << "'" << endl;
+            return 1;
+        }
+    }
+    
+    if (rollupFormat == PnLRollup::BINARY && rollupWidths.empty()) {
+        cerr << "Error: --binary requires --rollup" << endl;
+        return 1;
+    }
+    
+    ParseReport report;
+    vector<Trade> trades = CSVParser::parseFile(filename, parseOptions, report);
+    if (report.isFailed()) {
+        return 1;
+    }
+    if (report.getTotal() > 0) {
+        cerr << "Warning: " << report.getTotal() << " invalid rows in " << filename << endl;
+        report.print(cerr);
+    }
+    if (report.isStopped()) {
+        return 1;
+    }
+    
     if (trades.empty()) {
         cerr << "Error: No trades found in file" << endl;
         return 1;
@@ -276,6 +746,18 @@ int main(int argc, char* argv[]) {
     PnLCalculator calculator(scheme);
     vector<PnLResult> results = calculator.processTrades(trades);
 
+    if (!rollupWidths.empty()) {
+        PnLRollup rollup(rollupWidths, cout, rollupFormat);
+        rollup.writeHeader();
+        rollup.add(results);
+        rollup.flush();
+        if (rollup.getSkipped() > 0) {
+            cerr << "Warning: " << rollup.getSkipped()
+                 << " buckets not written, symbol longer than 65535 bytes" << endl;
+        }
+        return 0;
+    }
+
     cout << "TIMESTAMP,SYMBOL,PNL" << endl;
 
     for (vector<PnLResult>::const_iterator it = results.begin(); it != results.end(); ++it) {
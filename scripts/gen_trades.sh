@@ -0,0 +1,32 @@
+#!/bin/sh
+# Writes a synthetic trade file to stdout in the TIMESTAMP,SYMBOL,BUY_OR_SELL,PRICE,QUANTITY
+# format. The output depends only on the arguments (and the awk implementation), so the same
+# command always produces the same workload.
+#
+# Usage: scripts/gen_trades.sh <rows> [seed] [symbols]
+
+set -e
+
+ROWS=${1:?usage: $0 <rows> [seed] [symbols]}
+SEED=${2:-1}
+SYMBOLS=${3:-50}
+
+awk -v rows="$ROWS" -v seed="$SEED" -v symbols="$SYMBOLS" 'BEGIN {
+    srand(seed)
+    for (s = 0; s < symbols; ++s) {
+        name[s] = sprintf("SYM%03d", s)
+        price[s] = 10 + rand() * 990
+    }
+
+    print "TIMESTAMP,SYMBOL,BUY_OR_SELL,PRICE,QUANTITY"
+    ts = 1700000000
+    for (i = 0; i < rows; ++i) {
+        ts += int(rand() * 3)          # repeated timestamps are common in real feeds
+        s = int(rand() * symbols)
+        price[s] *= 1 + (rand() - 0.5) * 0.002
+        if (price[s] < 0.01) price[s] = 0.01
+        side = (rand() < 0.5) ? "B" : "S"
+        qty = 1 + int(rand() * 500)
+        printf "%d,%s,%s,%.2f,%d\n", ts, name[s], side, price[s], qty
+    }
+}'
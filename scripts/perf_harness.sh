@@ -0,0 +1,102 @@
+#!/bin/sh
+# Times every pnl_calculator_main_* variant in a build directory on the standard inputs in
+# data/ and on generated files of increasing size, then reports the median wall time and the
+# speedup over the first variant (the -O0 build when produced by `make variants`). Each
+# variant's output is compared with the baseline's so a faster but wrong build is caught.
+#
+# Usage: scripts/perf_harness.sh [build_dir]
+#
+# Environment:
+#   ROWS     synthetic file sizes in rows (default "100000 1000000 5000000")
+#   REPEAT   timed runs per variant and input; the median is reported (default 5)
+#   METHOD   accounting scheme passed to the binary (default fifo)
+#   VARIANTS space separated variant suffixes to compare (default "O0 O3 native lto pgo")
+
+set -e
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+REPO_DIR=$(dirname "$SCRIPT_DIR")
+BUILD_DIR=${1:-$REPO_DIR/build}
+ROWS=${ROWS:-"100000 1000000 5000000"}
+REPEAT=${REPEAT:-5}
+METHOD=${METHOD:-fifo}
+VARIANTS=${VARIANTS:-"O0 O3 native lto pgo"}
+BENCH_DIR="$BUILD_DIR/bench"
+
+mkdir -p "$BENCH_DIR"
+
+BINARIES=""
+for variant in $VARIANTS; do
+    binary="$BUILD_DIR/pnl_calculator_main_$variant"
+    if [ -x "$binary" ]; then
+        BINARIES="$BINARIES $binary"
+    else
+        echo "Skipping $variant: $binary not found (run 'make variants')" >&2
+    fi
+done
+if [ -z "$BINARIES" ]; then
+    echo "Error: no variants to compare in $BUILD_DIR" >&2
+    exit 1
+fi
+
+# seed 1 keeps the benchmark inputs distinct from the PGO training set
+for rows in $ROWS; do
+    if [ ! -f "$BENCH_DIR/synthetic_$rows.csv" ]; then
+        "$SCRIPT_DIR/gen_trades.sh" "$rows" 1 > "$BENCH_DIR/synthetic_$rows.csv"
+    fi
+done
+
+# runs a binary over one input group, writing all output to $2
+run_input() {
+    binary=$1
+    output=$2
+    input=$3
+    if [ "$input" = "data" ]; then
+        for file in "$REPO_DIR"/data/*.csv; do
+            "$binary" "$file" "$METHOD"
+        done > "$output" 2>&1
+    else
+        "$binary" "$BENCH_DIR/synthetic_$input.csv" "$METHOD" > "$output" 2>&1
+    fi
+}
+
+# prints the median wall time in milliseconds over $REPEAT runs
+time_input() {
+    samples=""
+    i=0
+    while [ "$i" -lt "$REPEAT" ]; do
+        start=$(date +%s%N)
+        run_input "$1" /dev/null "$2"
+        end=$(date +%s%N)
+        samples="$samples $(( (end - start) / 1000000 ))"
+        i=$((i + 1))
+    done
+    echo $samples | tr ' ' '\n' | sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+printf "%-10s %-16s %10s %9s\n" "INPUT" "VARIANT" "MEDIAN_MS" "SPEEDUP"
+
+status=0
+for input in data $ROWS; do
+    baseline=""
+    baseline_ms=""
+    for binary in $BINARIES; do
+        variant=${binary##*/pnl_calculator_main_}
+        run_input "$binary" "$BENCH_DIR/output_$variant.txt" "$input"
+        if [ -z "$baseline" ]; then
+            baseline=$variant
+        elif ! cmp -s "$BENCH_DIR/output_$baseline.txt" "$BENCH_DIR/output_$variant.txt"; then
+            echo "Error: $variant output differs from $baseline on $input" >&2
+            status=1
+        fi
+
+        ms=$(time_input "$binary" "$input")
+        if [ -z "$baseline_ms" ]; then
+            baseline_ms=$ms
+        fi
+        speedup=$(awk -v base="$baseline_ms" -v ms="$ms" 'BEGIN { printf "%.2fx", (ms > 0) ? base / ms : 0 }')
+        printf "%-10s %-16s %10s %9s\n" "$input" "$variant" "$ms" "$speedup"
+    done
+done
+
+exit $status
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs an instrumented pnl_calculator_main over the PGO training workload so the compiler
+# can collect branch and call profiles. The workload covers both accounting schemes and the
+# rollup output, which are the paths a release run exercises.
+#
+# Usage: scripts/pgo_train.sh <instrumented_binary> <work_dir> [rows]
+
+set -e
+
+BINARY=${1:?usage: $0 <instrumented_binary> <work_dir> [rows]}
+WORK_DIR=${2:?usage: $0 <instrumented_binary> <work_dir> [rows]}
+ROWS=${3:-1000000}
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+
+mkdir -p "$WORK_DIR"
+# the row count is part of the name so a different size is never served from a stale file
+TRAIN_FILE="$WORK_DIR/pgo_train_$ROWS.csv"
+
+# seed 7 keeps the training set distinct from the benchmark inputs in perf_harness.sh
+if [ ! -f "$TRAIN_FILE" ]; then
+    "$SCRIPT_DIR/gen_trades.sh" "$ROWS" 7 > "$TRAIN_FILE"
+fi
+
+"$BINARY" "$TRAIN_FILE" fifo > /dev/null
+"$BINARY" "$TRAIN_FILE" lifo > /dev/null
+"$BINARY" "$TRAIN_FILE" fifo --rollup 1m,1h > /dev/null